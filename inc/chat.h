@@ -30,6 +30,20 @@ enum {
     MODEM_CHAT_RESP_NOT_NEED = MODEM_CHAT_RESP_MAX,
 };
 
+// max bytes left unconsumed after the last matched response
+#define MODEM_CHAT_REST_MAX 16
+
+// command line body (without "AT" and "\r") which V.250 guarantees the modem
+// accepts, used as the default limit of concatenated command lines
+#ifndef MODEM_CHAT_LINE_MAX
+#define MODEM_CHAT_LINE_MAX 40
+#endif
+// upper bound of a per modem line limit
+#define MODEM_CHAT_LINE_LIMIT 120
+#if MODEM_CHAT_LINE_MAX > MODEM_CHAT_LINE_LIMIT
+#error "MODEM_CHAT_LINE_MAX is too large"
+#endif
+
 struct modem_chat_data {
     const char* transmit;
     rt_uint8_t expect;      // use CHAT_RESP_xxx
@@ -39,5 +53,11 @@ struct modem_chat_data {
 
 
 rt_err_t modem_chat(struct rt_serial_device *serial, const struct modem_chat_data *data, rt_size_t len);
+// chat without touching serial rx_indicate, the caller's rx_indicate must signal rx_comp.
+// line_max is the modem's command line body limit, 0 disables concatenation.
+// rest (MODEM_CHAT_REST_MAX bytes) receives the bytes after the last matched response
+rt_err_t modem_chat_ex(struct rt_serial_device *serial, struct rt_completion *rx_comp,
+                       const struct modem_chat_data *data, rt_size_t len, rt_size_t line_max,
+                       char *rest, rt_size_t *rest_len);
 
 #endif
@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Change Logs:
+ * Date           Author          Notes
+ * 2026-10-19     agent           the first version, restore dns servers and prefetch hostnames
+ */
+
+#ifndef __modem_dnscache_h__
+#define __modem_dnscache_h__
+
+#include <rtthread.h>
+
+#ifndef MODEM_DNS_PREFETCH_MAX
+#define MODEM_DNS_PREFETCH_MAX      4
+#endif
+
+#ifndef MODEM_DNS_CACHE_NAME_MAX
+#define MODEM_DNS_CACHE_NAME_MAX    48
+#endif
+
+// called by modem when ppp link is up/down, must run in tcpip thread
+void modem_dns_cache_link_up(void);
+void modem_dns_cache_link_down(void);
+
+// hostname will be resolved again as soon as every ppp link is up
+rt_err_t modem_dns_cache_prefetch(const char *name);
+
+#endif
@@ -14,9 +14,20 @@
 #include <rtthread.h>
 #include <rtdevice.h>
 #include <ppp/ppp.h>
+#include <chat.h>
 
 void m6312_attach(const char *device_name, rt_base_t power_pin);
 
+struct modem_link_quality
+{
+    rt_uint16_t mtu;        // negotiated mtu of the current session
+    rt_uint16_t mru;        // mru asked for in the current session
+    rt_uint32_t octets;     // ppp payload octets since link up, with ip/tcp headers, lcp and retransmits
+    rt_uint32_t throughput; // octets per second since link up, not application goodput
+    rt_uint32_t frames;     // good frames received in the current session
+    rt_uint32_t errors;     // bad fcs and discarded frames in the current session
+};
+
 struct modem
 {
     struct netif pppif;
@@ -25,9 +36,31 @@ struct modem
 
     struct rt_serial_device *serial;
     rt_err_t (*prepare)(struct modem *modem);
+    rt_uint8_t chat_line_max;   // command line body limit, 0 disables concatenation
+
+    // modem thread is the only serial reader, chat leaves what it read
+    // after the last response here and ppp consumes it first
+    rt_uint8_t rx_rest_len;
+    char rx_rest[MODEM_CHAT_REST_MAX];
+
+#ifdef MODEM_USING_ADAPTIVE_MTU
+    rt_uint16_t mru;                    // asked for in the next session
+    rt_uint32_t sample_frames;          // counted over sessions until enough to judge
+    rt_uint32_t sample_errors;
+    rt_uint32_t frames_base;            // pppif mib2 counters at session start
+    rt_uint32_t errors_base;
+    rt_uint32_t octets_base;            // pppif mib2 counters at link up
+    rt_tick_t link_up_tick;             // 0 if link is down
+#endif
 };
 
 struct rt_serial_device* modem_open_serial(const char *device_name);
 void modem_attach(struct modem *modem);
+// chat in prepare(), keep the bytes after the last response for ppp
+rt_err_t modem_serial_chat(struct modem *modem, const struct modem_chat_data *data, rt_size_t len);
+#if defined(MODEM_USING_ADAPTIVE_MTU) && defined(RT_USING_NETDEV)
+struct netdev;
+rt_err_t modem_get_link_quality(struct netdev *netdev, struct modem_link_quality *quality);
+#endif
 
 #endif
@@ -13,7 +13,7 @@
 #define DBG_LVL    DBG_INFO
 #include <rtdbg.h>
 
-#define CHAT_READ_BUF_MAX 16
+#define CHAT_READ_BUF_MAX MODEM_CHAT_REST_MAX
 
 // In order to match response, we need a string search algorithm
 // KMP and AC algorithm both are good choice, But we need the code
@@ -63,6 +63,16 @@ static rt_bool_t resp_matched(rt_uint8_t resp_id, rt_uint8_t state)
     return state == resp_strlen[resp_id];
 }
 
+struct chat_session
+{
+    struct rt_serial_device *serial;
+    struct rt_completion *rx_comp;
+    char *rest;
+    rt_size_t *rest_len;
+    rt_size_t line_max;     // command line body limit
+    rt_size_t saved;        // round trips saved by concatenation
+};
+
 static rt_err_t chat_rx_ind(rt_device_t device, rt_size_t size)
 {
     struct rt_serial_device *serial = (struct rt_serial_device*)device;
@@ -72,11 +82,12 @@ static rt_err_t chat_rx_ind(rt_device_t device, rt_size_t size)
     return RT_EOK;
 }
 
-static rt_size_t chat_read_until(struct rt_serial_device *serial, void *buffer, rt_size_t size, rt_tick_t stop)
+static rt_size_t chat_read_until(struct chat_session *session, void *buffer, rt_size_t size, rt_tick_t stop)
 {
     rt_size_t rdlen;
     rt_tick_t wait;
-    struct rt_completion *rx_comp_p = serial->user_data;
+    struct rt_serial_device *serial = session->serial;
+    struct rt_completion *rx_comp_p = session->rx_comp;
 
     rt_completion_init(rx_comp_p);
     rdlen = rt_device_read(&serial->parent, 0, buffer, size);
@@ -91,8 +102,18 @@ static rt_size_t chat_read_until(struct rt_serial_device *serial, void *buffer,
     return rt_device_read(&serial->parent, 0, buffer, size);
 }
 
-static rt_err_t modem_chat_once(struct rt_serial_device *serial, const struct modem_chat_data *data)
+static void chat_save_rest(struct chat_session *session, const char *buf, rt_size_t len)
 {
+    if (!session->rest_len)
+        return;
+    if (len)
+        rt_memcpy(session->rest, buf, len);
+    *session->rest_len = len;
+}
+
+static rt_err_t modem_chat_once(struct chat_session *session, const struct modem_chat_data *data)
+{
+    struct rt_serial_device *serial = session->serial;
     rt_uint8_t resp_state[MODEM_CHAT_RESP_MAX] = { 0 }, resp;
     rt_tick_t stop = rt_tick_get() + data->timeout*RT_TICK_PER_SECOND;
     rt_size_t rdlen, pos;
@@ -108,12 +129,13 @@ static rt_err_t modem_chat_once(struct rt_serial_device *serial, const struct mo
     if (data->expect == MODEM_CHAT_RESP_NOT_NEED)
     {
         rt_thread_mdelay(1000*data->timeout);
+        chat_save_rest(session, RT_NULL, 0);
         return RT_EOK;
     }
 
     do
     {
-        rdlen = chat_read_until(serial, rdbuf, CHAT_READ_BUF_MAX, stop);
+        rdlen = chat_read_until(session, rdbuf, CHAT_READ_BUF_MAX, stop);
         for (pos = 0; pos < rdlen; pos++)
         {
             for (resp = 0; resp < MODEM_CHAT_RESP_MAX; resp++)
@@ -122,7 +144,11 @@ static rt_err_t modem_chat_once(struct rt_serial_device *serial, const struct mo
                 if (resp_matched(resp, resp_state[resp]))
                 {
                     if (resp == data->expect)
+                    {
+                        // e.g. ppp frames right after CONNECT
+                        chat_save_rest(session, rdbuf + pos + 1, rdlen - pos - 1);
                         return RT_EOK;
+                    }
 
                     LOG_W(CHAT_DATA_FMT" not matched, got: %s", CHAT_DATA_STR(data), resp2str(resp));
                     return -RT_ERROR;
@@ -134,27 +160,174 @@ static rt_err_t modem_chat_once(struct rt_serial_device *serial, const struct mo
     return -RT_ETIMEOUT;
 }
 
-static rt_err_t modem_chat_internal(struct rt_serial_device *serial, const struct modem_chat_data *data, rt_size_t len)
+// V.250 allows several commands in one command line, basic commands are
+// simply appended and an extended command is terminated by ';'. Merge the
+// consecutive commands which only want OK, so the script costs fewer round
+// trips. Commands need retries (e.g. the "AT" used for sync), dial, reset
+// the modem, or already contain ';' or a line end are kept alone.
+static rt_bool_t chat_extended(const char *body)
+{
+    return body[0] == '+' || body[0] == '%' || body[0] == '$' || body[0] == '^' || body[0] == '*';
+}
+
+static rt_bool_t chat_is_alpha(char ch)
+{
+    return (ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z');
+}
+
+// walk the basic commands before the first extended one, return where the
+// extended command starts (or the end of body). *resets is set if a basic
+// command is Z, &F or D
+static const char* chat_skip_basic(const char *body, rt_bool_t *resets)
+{
+    const char *p = body;
+
+    *resets = RT_FALSE;
+    while (*p && !chat_extended(p))
+    {
+        if (*p == '&')
+        {
+            p++;
+            if (*p == 'F' || *p == 'f')
+                *resets = RT_TRUE;
+        }
+        else if (*p == 'Z' || *p == 'z' || *p == 'D' || *p == 'd')
+            *resets = RT_TRUE;
+
+        if (*p)
+            p++;
+        // skip parameters, e.g. the "0=0" of "S0=0"
+        while (*p && !chat_extended(p) && !chat_is_alpha(*p) && *p != '&')
+            p++;
+    }
+    return p;
+}
+
+// without ';' nothing can follow an extended command in the same body
+static rt_bool_t chat_ends_extended(const char *body)
+{
+    rt_bool_t resets;
+
+    return *chat_skip_basic(body, &resets) != '\0';
+}
+
+static rt_bool_t chat_concatable(const struct modem_chat_data *data)
+{
+    const char *s = data->transmit;
+    rt_bool_t resets;
+
+    if (!s || data->expect != MODEM_CHAT_RESP_OK || data->retries != 1)
+        return RT_FALSE;
+    if ((s[0] != 'A' && s[0] != 'a') || (s[1] != 'T' && s[1] != 't') || s[2] == '\0')
+        return RT_FALSE;
+    if (rt_strstr(s, ";") || rt_strstr(s, "\r") || rt_strstr(s, "\n"))
+        return RT_FALSE;
+    chat_skip_basic(s + 2, &resets);
+    return !resets;
+}
+
+// build the merged command line, return how many commands were merged
+static rt_size_t chat_concat(const struct modem_chat_data *data, rt_size_t len, rt_size_t line_max,
+                             char *line, struct modem_chat_data *merged)
+{
+    rt_size_t n, linelen, bodylen, need;
+    rt_uint32_t timeout;
+    rt_bool_t extended;
+    const char *body;
+
+    if (!chat_concatable(&data[0]))
+        return 1;
+
+    body = data[0].transmit + 2;
+    linelen = 2 + rt_strlen(body);
+    if (linelen - 2 > line_max)
+        return 1;
+    rt_memcpy(line, "AT", 2);
+    rt_memcpy(line + 2, body, linelen - 2);
+    extended = chat_ends_extended(body);
+    timeout = data[0].timeout;
+
+    for (n = 1; n < len && chat_concatable(&data[n]); n++)
+    {
+        body = data[n].transmit + 2;
+        bodylen = rt_strlen(body);
+        need = bodylen + (extended ? 1 : 0);
+        if (linelen - 2 + need > line_max)
+            break;
+        if (extended)
+            line[linelen++] = ';';
+        rt_memcpy(line + linelen, body, bodylen);
+        linelen += bodylen;
+        extended = chat_ends_extended(body);
+        timeout += data[n].timeout;
+    }
+    line[linelen] = '\0';
+
+    merged->transmit = line;
+    merged->expect = MODEM_CHAT_RESP_OK;
+    merged->retries = 1;
+    merged->timeout = timeout > 255 ? 255 : timeout;
+    return n;
+}
+
+static rt_err_t modem_chat_single(struct chat_session *session, const struct modem_chat_data *data)
 {
     rt_err_t err = RT_EOK;
-    rt_size_t i;
     rt_uint8_t retry_time;
 
-    for (i = 0; i < len; i++)
+    LOG_D(CHAT_DATA_FMT" running", CHAT_DATA_STR(data));
+    for (retry_time = 0; retry_time < data->retries; retry_time++)
+    {
+        err = modem_chat_once(session, data);
+        if (err == RT_EOK)
+            break;
+    }
+    if (err)
+    {
+        LOG_E(CHAT_DATA_FMT" fail", CHAT_DATA_STR(data));
+        return err;
+    }
+    LOG_D(CHAT_DATA_FMT" success", CHAT_DATA_STR(data));
+    return RT_EOK;
+}
+
+static rt_err_t modem_chat_internal(struct chat_session *session, const struct modem_chat_data *data, rt_size_t len)
+{
+    rt_err_t err = RT_EOK;
+    rt_size_t i, k, n;
+    struct modem_chat_data merged;
+    char line[2 + MODEM_CHAT_LINE_LIMIT + 1];
+
+    session->saved = 0;
+    for (i = 0; i < len; i += n)
     {
-        LOG_D(CHAT_DATA_FMT" running", CHAT_DATA_STR(&data[i]));
-        for (retry_time = 0; retry_time < data[i].retries; retry_time++)
+        n = chat_concat(&data[i], len - i, session->line_max, line, &merged);
+        if (n > 1)
         {
-            err = modem_chat_once(serial, &data[i]);
+            LOG_D(CHAT_DATA_FMT" running, %u commands merged", CHAT_DATA_STR(&merged), n);
+            err = modem_chat_once(session, &merged);
             if (err == RT_EOK)
-                break;
+            {
+                session->saved += n - 1;
+                continue;
+            }
+            // a late OK of a timed out line would be taken as the reply of
+            // the first single command, so only split on an explicit reply
+            if (err == -RT_ETIMEOUT)
+            {
+                LOG_E(CHAT_DATA_FMT" fail", CHAT_DATA_STR(&merged));
+                return err;
+            }
+            // split the line to find out which command fails
+            LOG_W(CHAT_DATA_FMT" fail, run commands one by one", CHAT_DATA_STR(&merged));
         }
-        if (err)
+
+        for (k = 0; k < n; k++)
         {
-            LOG_E(CHAT_DATA_FMT" fail", CHAT_DATA_STR(&data[i]));
-            break;
+            err = modem_chat_single(session, &data[i + k]);
+            if (err)
+                return err;
         }
-        LOG_D(CHAT_DATA_FMT" success", CHAT_DATA_STR(&data[i]));
     }
     return err;
 }
@@ -164,20 +337,50 @@ rt_err_t modem_chat(struct rt_serial_device *serial, const struct modem_chat_dat
     rt_err_t (*old_rx_ind)(rt_device_t dev, rt_size_t size) = NULL;
     rt_err_t err;
     void *old_user_data;
+    rt_base_t level;
     struct rt_completion rx_comp;
+    struct chat_session session = { serial, &rx_comp, RT_NULL, RT_NULL, MODEM_CHAT_LINE_MAX, 0 };
 
     rt_completion_init(&rx_comp);
+    // rx_indicate and user_data must be swapped together, rx isr may come between them
+    level = rt_hw_interrupt_disable();
     old_rx_ind = serial->parent.rx_indicate;
     old_user_data = serial->user_data;
     serial->user_data = &rx_comp;
-    rt_device_set_rx_indicate(&serial->parent, chat_rx_ind);
+    serial->parent.rx_indicate = chat_rx_ind;
+    rt_hw_interrupt_enable(level);
 
-    err = modem_chat_internal(serial, data, len);
+    err = modem_chat_internal(&session, data, len);
 
     if (err == RT_EOK)
-        LOG_I("chat success");
+        LOG_I("chat success, %u round trips saved", session.saved);
 
+    level = rt_hw_interrupt_disable();
     serial->parent.rx_indicate = old_rx_ind;
     serial->user_data = old_user_data;
+    rt_hw_interrupt_enable(level);
+    return err;
+}
+
+rt_err_t modem_chat_ex(struct rt_serial_device *serial, struct rt_completion *rx_comp,
+                       const struct modem_chat_data *data, rt_size_t len, rt_size_t line_max,
+                       char *rest, rt_size_t *rest_len)
+{
+    rt_err_t err;
+    struct chat_session session = { serial, rx_comp, rest, rest_len, line_max, 0 };
+
+    RT_ASSERT(rx_comp);
+    RT_ASSERT(!rest_len || rest);
+    RT_ASSERT(line_max <= MODEM_CHAT_LINE_LIMIT);
+
+    if (rest_len)
+        *rest_len = 0;
+
+    err = modem_chat_internal(&session, data, len);
+
+    if (err == RT_EOK)
+        LOG_I("chat success, %u round trips saved", session.saved);
+    else if (rest_len)
+        *rest_len = 0;
     return err;
 }
@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Change Logs:
+ * Date           Author          Notes
+ * 2026-10-19     agent           the first version, restore dns servers and prefetch hostnames
+ */
+
+#include <dnscache.h>
+#include <lwip/dns.h>
+#include <lwip/tcpip.h>
+
+#define DBG_TAG    "dnscache"
+#define DBG_LVL    DBG_INFO
+#include <rtdbg.h>
+
+// This state lives as long as the system, so a reconnect does not have to
+// pay for DNS round trips again:
+//   1. dns servers got from the last ppp session are restored if the peer
+//      does not give us new ones.
+//   2. hostnames registered for prefetch are resolved as soon as the link
+//      is up. The answers land in the lwIP dns table, which honours the
+//      record TTL and serves getaddrinfo() without a round trip.
+
+static char dns_prefetch[MODEM_DNS_PREFETCH_MAX][MODEM_DNS_CACHE_NAME_MAX];
+static ip_addr_t dns_cache_server[DNS_MAX_SERVERS];
+static rt_bool_t dns_cache_online;
+
+static void dns_cache_found(const char *name, const ip_addr_t *ipaddr, void *arg)
+{
+    LWIP_UNUSED_ARG(arg);
+
+    if (ipaddr == RT_NULL)
+    {
+        LOG_W("prefetch %s fail", name);
+        return;
+    }
+    LOG_D("%s -> %s", name, ipaddr_ntoa(ipaddr));
+}
+
+// must be called in tcpip thread
+static void dns_cache_resolve(void *ctx)
+{
+    const char *slot = ctx;
+    char name[MODEM_DNS_CACHE_NAME_MAX];
+    ip_addr_t addr;
+
+    rt_enter_critical();
+    rt_strncpy(name, slot, MODEM_DNS_CACHE_NAME_MAX);
+    rt_exit_critical();
+    if (name[0] == '\0')
+        return;
+
+    // ERR_OK means the lwIP table already has a valid answer
+    if (dns_gethostbyname(name, &addr, dns_cache_found, RT_NULL) == ERR_OK)
+        LOG_D("%s -> %s (cached)", name, ipaddr_ntoa(&addr));
+}
+
+#ifdef MODEM_DNS_PREFETCH_HOSTS
+// MODEM_DNS_PREFETCH_HOSTS is a comma separated hostname list
+static void dns_cache_register_config_hosts(void)
+{
+    static rt_bool_t registered = RT_FALSE;
+    const char *p = MODEM_DNS_PREFETCH_HOSTS;
+    char name[MODEM_DNS_CACHE_NAME_MAX];
+    rt_size_t len;
+
+    if (registered)
+        return;
+    registered = RT_TRUE;
+
+    while (*p)
+    {
+        for (len = 0; p[len] && p[len] != ','; len++);
+        if (len > 0 && len < MODEM_DNS_CACHE_NAME_MAX)
+        {
+            rt_memcpy(name, p, len);
+            name[len] = '\0';
+            modem_dns_cache_prefetch(name);
+        }
+        p += len;
+        if (*p == ',')
+            p++;
+    }
+}
+#endif
+
+void modem_dns_cache_link_up(void)
+{
+    const ip_addr_t *server;
+    u8_t i;
+
+    for (i = 0; i < DNS_MAX_SERVERS; i++)
+    {
+        server = dns_getserver(i);
+        if (!ip_addr_isany(server))
+            ip_addr_copy(dns_cache_server[i], *server);
+        else if (!ip_addr_isany(&dns_cache_server[i]))
+        {
+            LOG_I("peer did not give dns%u, use %s", i, ipaddr_ntoa(&dns_cache_server[i]));
+            dns_setserver(i, &dns_cache_server[i]);
+        }
+    }
+
+#ifdef MODEM_DNS_PREFETCH_HOSTS
+    dns_cache_register_config_hosts();
+#endif
+    dns_cache_online = RT_TRUE;
+
+    for (i = 0; i < MODEM_DNS_PREFETCH_MAX; i++)
+        dns_cache_resolve(dns_prefetch[i]);
+}
+
+void modem_dns_cache_link_down(void)
+{
+    dns_cache_online = RT_FALSE;
+}
+
+rt_err_t modem_dns_cache_prefetch(const char *name)
+{
+    char *slot = RT_NULL;
+    int i;
+
+    RT_ASSERT(name);
+    if (name[0] == '\0' || rt_strlen(name) >= MODEM_DNS_CACHE_NAME_MAX)
+        return -RT_EINVAL;
+
+    rt_enter_critical();
+    for (i = 0; i < MODEM_DNS_PREFETCH_MAX; i++)
+    {
+        if (rt_strcmp(dns_prefetch[i], name) == 0)
+        {
+            slot = dns_prefetch[i];
+            break;
+        }
+        if (!slot && dns_prefetch[i][0] == '\0')
+            slot = dns_prefetch[i];
+    }
+    if (slot && slot[0] == '\0')
+        rt_strncpy(slot, name, MODEM_DNS_CACHE_NAME_MAX - 1);
+    rt_exit_critical();
+
+    if (!slot)
+    {
+        LOG_W("prefetch list is full, can not add %s", name);
+        return -RT_EFULL;
+    }
+
+    if (dns_cache_online)
+        tcpip_callback(dns_cache_resolve, slot);
+    return RT_EOK;
+}
@@ -58,7 +58,7 @@ static rt_err_t m6312_chat(struct modem *modem)
         { M6312_SET_APN,    MODEM_CHAT_RESP_OK,         1,      5},
         { M6312_SET_ATD,    MODEM_CHAT_RESP_CONNECT,    1,      30},
     };
-    return modem_chat(modem->serial, mcd, sizeof(mcd)/sizeof(mcd[0]));
+    return modem_serial_chat(modem, mcd, sizeof(mcd)/sizeof(mcd[0]));
 }
 
 static rt_err_t m6312_prepare(struct modem *modem)
@@ -82,6 +82,7 @@ void m6312_attach(const char *device_name, rt_base_t power_pin)
 
     m6312->modem.prepare = m6312_prepare;
     m6312->modem.serial = serial;
+    m6312->modem.chat_line_max = MODEM_CHAT_LINE_MAX;
     modem_attach(&m6312->modem);
     return;
 err:
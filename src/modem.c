@@ -12,6 +12,14 @@
 #include <pppnetif.h>
 #include <lwip/dns.h>
 #include <pppapi.h>
+#ifdef MODEM_USING_DNS_CACHE
+#include <dnscache.h>
+#endif
+#ifdef MODEM_USING_ADAPTIVE_MTU
+#ifdef RT_USING_NETDEV
+#include <netdev.h>
+#endif
+#endif
 
 #define DBG_TAG    "modem"
 #define DBG_LVL    DBG_INFO
@@ -29,6 +37,136 @@
 #define MODEM_THREAD_PRIORITY (RT_THREAD_PRIORITY_MAX - 2)
 #endif
 
+#ifdef MODEM_USING_ADAPTIVE_MTU
+
+// frames and discards are counted per netif by pppos only with MIB2_STATS
+#if !MIB2_STATS
+#error "MODEM_USING_ADAPTIVE_MTU requires MIB2_STATS in lwIP"
+#endif
+
+#ifndef MODEM_MTU_MIN
+#define MODEM_MTU_MIN 296
+#endif
+
+#ifndef MODEM_MTU_STEP
+#define MODEM_MTU_STEP 128
+#endif
+
+// thresholds in per mille
+#ifndef MODEM_MTU_ERR_HIGH
+#define MODEM_MTU_ERR_HIGH 20
+#endif
+#ifndef MODEM_MTU_ERR_LOW
+#define MODEM_MTU_ERR_LOW 5
+#endif
+
+// frames needed before the mru is changed in either direction
+#ifndef MODEM_MTU_SAMPLE_FRAMES
+#define MODEM_MTU_SAMPLE_FRAMES 100
+#endif
+
+#define MODEM_MIB2(modem)   ((modem)->pppif.mib2_counters)
+
+// pppos counts a bad fcs once, as ifindiscards
+static rt_uint32_t modem_frames(struct modem *modem)
+{
+    return MODEM_MIB2(modem).ifinucastpkts;
+}
+
+static rt_uint32_t modem_errors(struct modem *modem)
+{
+    return MODEM_MIB2(modem).ifindiscards;
+}
+
+static rt_uint32_t modem_octets(struct modem *modem)
+{
+    return MODEM_MIB2(modem).ifinoctets + MODEM_MIB2(modem).ifoutoctets;
+}
+
+static void modem_session_start(struct modem *modem)
+{
+    modem->frames_base = modem_frames(modem);
+    modem->errors_base = modem_errors(modem);
+    modem->link_up_tick = 0;
+
+    modem->ppp->lcp_wantoptions.neg_mru = 1;
+    modem->ppp->lcp_wantoptions.mru = modem->mru;
+    modem->ppp->lcp_allowoptions.mru = modem->mru;
+}
+
+static void modem_link_up(struct modem *modem)
+{
+    modem->octets_base = modem_octets(modem);
+    modem->link_up_tick = rt_tick_get() | 1;
+}
+
+// Big frames cost a full retransmit for one bad FCS, small frames waste
+// bandwidth on headers. Shrink the mru when the link was noisy and grow it
+// back when the link was clean. Sessions which fail before the link is up
+// count too, they are often the noisiest ones. The netif mtu follows the
+// negotiated size, and lwIP derives the tcp mss from it.
+static void modem_session_end(struct modem *modem)
+{
+    rt_uint32_t total, err_rate;
+
+    modem->sample_frames += modem_frames(modem) - modem->frames_base;
+    modem->sample_errors += modem_errors(modem) - modem->errors_base;
+    modem->link_up_tick = 0;
+
+    total = modem->sample_frames + modem->sample_errors;
+    if (total < MODEM_MTU_SAMPLE_FRAMES)
+        return;
+
+    err_rate = modem->sample_errors * 1000 / total;
+    if (err_rate > MODEM_MTU_ERR_HIGH)
+        modem->mru = LWIP_MAX(MODEM_MTU_MIN, modem->mru * 3 / 4);
+    else if (err_rate < MODEM_MTU_ERR_LOW)
+        modem->mru = LWIP_MIN(PPPNET_MTU, modem->mru + MODEM_MTU_STEP);
+
+    LOG_I("link: frames %u, error %u/1000, next mru %u", total, err_rate, modem->mru);
+    modem->sample_frames = 0;
+    modem->sample_errors = 0;
+}
+
+#ifdef RT_USING_NETDEV
+static void modem_link_status_cb(ppp_pcb *ppp, int errCode, void *ctx);
+
+rt_err_t modem_get_link_quality(struct netdev *netdev, struct modem_link_quality *quality)
+{
+    struct netif *netif;
+    struct modem *modem;
+    rt_tick_t up_tick;
+    rt_uint32_t elapsed;
+    ppp_pcb *ppp;
+
+    RT_ASSERT(netdev);
+    RT_ASSERT(quality);
+
+    netif = netdev->user_data;
+    if (!netif || netif->name[0] != 'p' || netif->name[1] != 'p')
+        return -RT_EINVAL;
+    ppp = netif->state;
+    if (!ppp || ppp->link_status_cb != modem_link_status_cb)
+        return -RT_EINVAL;
+
+    modem = rt_container_of(netif, struct modem, pppif);
+    up_tick = modem->link_up_tick;
+    if (!up_tick)
+        return -RT_EEMPTY;
+
+    elapsed = (rt_tick_get() - up_tick) / RT_TICK_PER_SECOND;
+    quality->mtu = netif->mtu;
+    quality->mru = modem->mru;
+    quality->octets = modem_octets(modem) - modem->octets_base;
+    quality->throughput = quality->octets / (elapsed ? elapsed : 1);
+    quality->frames = modem_frames(modem) - modem->frames_base;
+    quality->errors = modem_errors(modem) - modem->errors_base;
+    return RT_EOK;
+}
+#endif
+
+#endif /* MODEM_USING_ADAPTIVE_MTU */
+
 #ifdef MODEM_RECONFIGURE_SERIAL
 static void modem_reconfigure_serial(struct rt_serial_device *serial)
 {
@@ -89,6 +227,18 @@ static rt_err_t modem_serial_cb(rt_device_t dev, rt_size_t size)
     return RT_EOK;
 }
 
+rt_err_t modem_serial_chat(struct modem *modem, const struct modem_chat_data *data, rt_size_t len)
+{
+    rt_size_t rest_len = 0;
+    rt_err_t err;
+
+    // modem_serial_cb stays installed, so no byte is lost between chat and ppp
+    err = modem_chat_ex(modem->serial, &modem->comp, data, len, modem->chat_line_max,
+                        modem->rx_rest, &rest_len);
+    modem->rx_rest_len = rest_len;
+    return err;
+}
+
 static u32_t modem_output_cb(ppp_pcb *ppp, u8_t *data, u32_t len, void *ctx)
 {
     struct netif *pppif = ppp_netif(ppp);
@@ -112,6 +262,12 @@ static void modem_link_status_cb(ppp_pcb *ppp, int errCode, void *ctx)
     switch(errCode)
     {
         case PPPERR_NONE: {             /* No error. */
+#ifdef MODEM_USING_DNS_CACHE
+            modem_dns_cache_link_up();
+#endif
+#ifdef MODEM_USING_ADAPTIVE_MTU
+            modem_link_up(modem);
+#endif
             ppp_netdev_add(&modem->pppif);
             LOG_D("pppLinkStatusCallback: PPPERR_NONE");
 #if LWIP_IPV4
@@ -184,6 +340,9 @@ static void modem_link_status_cb(ppp_pcb *ppp, int errCode, void *ctx)
 
     if (errCode != PPPERR_NONE)
     {
+#ifdef MODEM_USING_DNS_CACHE
+        modem_dns_cache_link_down();
+#endif
         rt_completion_done(&modem->comp);
     }
 }
@@ -198,9 +357,16 @@ static void modem_thread_entry(void *params)
     modem->serial->user_data = modem;
     rt_completion_init(&modem->comp);
     rt_device_set_rx_indicate(&modem->serial->parent, modem_serial_cb);
+#ifdef MODEM_USING_ADAPTIVE_MTU
+    modem->mru = PPPNET_MTU;
+    modem->sample_frames = 0;
+    modem->sample_errors = 0;
+    modem->link_up_tick = 0;
+#endif
 
     while (1)
     {
+        modem->rx_rest_len = 0;
         if (modem->prepare && modem->prepare(modem))
         {
             LOG_W("Modem is not ready, try again after 30s");
@@ -216,6 +382,9 @@ static void modem_thread_entry(void *params)
             return;
         }
         ppp_set_usepeerdns(modem->ppp, 1);
+#ifdef MODEM_USING_ADAPTIVE_MTU
+        modem_session_start(modem);
+#endif
         lwip_err = pppapi_connect(modem->ppp, 0);
         if (lwip_err != ERR_OK)
         {
@@ -223,6 +392,14 @@ static void modem_thread_entry(void *params)
             return;
         }
 
+        // bytes already read by chat after CONNECT
+        if (modem->rx_rest_len)
+        {
+            LOG_D("recv %u bytes left by chat", modem->rx_rest_len);
+            pppos_input_tcpip(modem->ppp, (u8_t*)modem->rx_rest, modem->rx_rest_len);
+            modem->rx_rest_len = 0;
+        }
+
         netif_set_default(&modem->pppif);
 
         // check serial rx event and ppp connection broken error event
@@ -246,6 +423,9 @@ static void modem_thread_entry(void *params)
         } while (1);
 
         ppp_netdev_del(&modem->pppif);
+#ifdef MODEM_USING_ADAPTIVE_MTU
+        modem_session_end(modem);
+#endif
 
         if (modem->ppp->phase != PPP_PHASE_DEAD)
             pppapi_close(modem->ppp, 1);